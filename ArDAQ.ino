@@ -16,6 +16,14 @@
 #define ADC_SCLK_PIN      A2
 #define RUN_LED_PIN       13
 
+// ADC offset calibration interval during a run (ms, 0 = only at run start)
+#define ADC_CAL_INTERVAL  600000UL
+// Nominal ADC conversion period (ms): 100 at 10 SPS (SPEED pin low), 12 at 80 SPS
+#define ADC_CONVERSION_PERIOD 100
+
+// In sequence mode, send a start request to the autosampler whenever READY returns between runs
+#define SEQ_AUTO_STARTREQ false
+
 // Includes
 #include <SPI.h>
 #include <Wire.h>
@@ -62,6 +70,9 @@ void setup() {
   adc.disable();
 
   // HSM
+  hsm.setCalibrationInterval(ADC_CAL_INTERVAL);
+  hsm.setConversionPeriod(ADC_CONVERSION_PERIOD);
+  hsm.setSequenceAutoStart(SEQ_AUTO_STARTREQ);
   hsm.onInitDone(); // go to the idle state
 }
 
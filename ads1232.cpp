@@ -32,6 +32,11 @@ void ADS1232::disable() {
 void ADS1232::offset_calibration() {
   // perform offset calibration by toggling the clock an extra time after reading the adc
   read_blocking();
+  start_offset_calibration();
+}
+void ADS1232::start_offset_calibration() {
+  // 26th clock pulse after a conversion has been read starts the calibration.
+  // DOUT stays high (not ready) until it has finished.
   digitalWrite(_sclk, HIGH);
   digitalWrite(_sclk, LOW);
 }
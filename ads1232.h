@@ -11,6 +11,7 @@ class ADS1232 {
     void enable();
     void disable();
     void offset_calibration();
+    void start_offset_calibration(); // call directly after read_blocking(), doesn't wait
     int32_t read_blocking();
     bool ready();
 
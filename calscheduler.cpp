@@ -0,0 +1,83 @@
+// Scheduling of ADS1232 offset self-calibration
+// The adc starts a calibration when it receives 26 clocks instead of 25 after a conversion is read out.
+// DOUT then stays high until the calibration is done, so the main loop simply keeps polling adc.ready()
+// and never blocks. The conversions that would have been produced in the meantime are lost; we estimate
+// how many from the normal conversion period so that the first sample after calibration can be flagged.
+
+#include "calscheduler.h"
+
+CalScheduler::CalScheduler(uint32_t interval_ms) {
+  _interval = interval_ms;
+  _nominal = 0;
+  reset(0);
+}
+
+void CalScheduler::setInterval(uint32_t interval_ms) {
+  _interval = interval_ms;
+}
+void CalScheduler::setNominalPeriod(uint32_t ms) {
+  _nominal = ms;
+  _period = ms;
+}
+void CalScheduler::reset(uint32_t now) {
+  _lastCal = now;
+  _lastSample = now;
+  _period = _nominal; // the calibration at the start of a run comes before any period could be measured
+  _haveSample = false;
+  _pending = false;
+  _calibrating = false;
+}
+void CalScheduler::request() {
+  _pending = true;
+}
+void CalScheduler::runStarted(uint32_t now) {
+  // A calibration started before the run only costs the run the conversions after its start
+  if (_calibrating) {
+    _lastSample = now;
+  }
+}
+
+bool CalScheduler::due(uint32_t now) {
+  if (_calibrating) {
+    return false;
+  }
+  if (_pending) {
+    return true;
+  }
+  return (_interval > 0) && (now - _lastCal >= _interval);
+}
+void CalScheduler::started(uint32_t now) {
+  _pending = false;
+  _calibrating = true;
+  _lastCal = now;
+}
+bool CalScheduler::inProgress() {
+  return _calibrating;
+}
+
+bool CalScheduler::sample(uint32_t now, uint16_t *lost) {
+  uint32_t gap = now - _lastSample;
+  bool first = !_haveSample;
+  _lastSample = now;
+  _haveSample = true;
+
+  if (_calibrating) {
+    _calibrating = false;
+    *lost = 0;
+    if (_period > 0 && gap > _period) {
+      *lost = (gap + _period/2) / _period - 1;
+    }
+    return true;
+  }
+
+  // Track the conversion period, ignoring the gaps caused by calibration and power up
+  if (first) {
+    return false;
+  }
+  if (_period == 0 || gap < _period) {
+    _period = gap;
+  } else {
+    _period = (_period * 7 + gap) / 8;
+  }
+  return false;
+}
@@ -0,0 +1,36 @@
+#ifndef CALSCHEDULER_H
+#define CALSCHEDULER_H
+
+#include <stdint.h>
+
+class CalScheduler {
+  public:
+    CalScheduler(uint32_t interval_ms);
+
+    void setInterval(uint32_t interval_ms); // 0 disables periodic calibration
+    void setNominalPeriod(uint32_t ms);     // expected conversion period, used until it has been measured
+    void reset(uint32_t now);               // forget timing history, e.g. at the start of a run
+    void request();                         // calibrate at the next opportunity (flag/serial events)
+    void runStarted(uint32_t now);          // a run starts without a reset (adc kept running in a sequence)
+
+    bool due(uint32_t now);                 // true if a calibration should be started after this conversion
+    void started(uint32_t now);             // the calibration clock has been sent to the adc
+    bool inProgress();
+
+    // Called for every conversion read. Returns true if this is the first
+    // conversion after a calibration, in which case *lost is set to the
+    // number of conversions that were skipped while calibrating.
+    bool sample(uint32_t now, uint16_t *lost);
+
+  private:
+    uint32_t _interval;
+    uint32_t _lastCal;
+    uint32_t _lastSample;
+    uint32_t _period;     // estimated conversion period (ms), 0 if unknown
+    uint32_t _nominal;    // what _period starts from after a reset
+    bool _haveSample;
+    bool _pending;
+    bool _calibrating;
+};
+
+#endif
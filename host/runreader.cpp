@@ -0,0 +1,158 @@
+#include "runreader.h"
+#include <cstdlib>
+#include <cstring>
+
+RunReader::RunReader() {
+  _csv = 0;
+  _idx = 0;
+  close();
+}
+RunReader::~RunReader() {
+  close();
+}
+
+bool RunReader::open(const std::string &csvPath) {
+  close();
+  _csv = fopen(csvPath.c_str(), "rb");
+  if (!_csv) {
+    return false;
+  }
+
+  std::string idxPath = csvPath;
+  size_t dot = idxPath.find_last_of('.');
+  if (dot != std::string::npos) {
+    idxPath.erase(dot);
+  }
+  idxPath += ".idx";
+  if (!loadIndex(idxPath)) {
+    // fall back to scanning the csv
+    if (_idx) {
+      fclose(_idx);
+      _idx = 0;
+    }
+    _hasIndex = false;
+    _hasSummary = false;
+  }
+  return true;
+}
+void RunReader::close() {
+  if (_csv) {
+    fclose(_csv);
+  }
+  if (_idx) {
+    fclose(_idx);
+  }
+  _csv = 0;
+  _idx = 0;
+  _hasIndex = false;
+  _hasSummary = false;
+  _entryCount = 0;
+  memset(&_header, 0, sizeof(_header));
+  memset(&_summary, 0, sizeof(_summary));
+}
+
+bool RunReader::loadIndex(const std::string &idxPath) {
+  _idx = fopen(idxPath.c_str(), "rb");
+  if (!_idx) {
+    return false;
+  }
+  if (fread(&_header, sizeof(_header), 1, _idx) != 1
+      || memcmp(_header.magic, "ADQI", 4) != 0
+      || _header.version != RUN_INDEX_VERSION
+      || _header.intervalMs == 0) {
+    return false;
+  }
+
+  if (fseek(_idx, 0, SEEK_END) != 0) {
+    return false;
+  }
+  long size = ftell(_idx);
+  if (size < (long)sizeof(_header)) {
+    return false;
+  }
+  uint32_t body = size - sizeof(_header);
+
+  // The summary is only there if the run ended cleanly
+  if (body >= sizeof(_summary) && (body - sizeof(_summary)) % sizeof(RunIndexEntry) == 0) {
+    RunSummary s;
+    if (fseek(_idx, size - sizeof(s), SEEK_SET) == 0
+        && fread(&s, sizeof(s), 1, _idx) == 1
+        && memcmp(s.magic, "ADQS", 4) == 0) {
+      _summary = s;
+      _hasSummary = true;
+      body -= sizeof(_summary);
+    }
+  }
+  // A partially written last entry (power lost mid-write) is ignored
+  _entryCount = body / sizeof(RunIndexEntry);
+  _hasIndex = true;
+  return true;
+}
+
+uint32_t RunReader::offsetFor(uint32_t timeMs) {
+  if (!_hasIndex || _entryCount == 0) {
+    return 0;
+  }
+  // Entry i is the first sample at or after i * interval
+  uint32_t i = timeMs / _header.intervalMs;
+  if (i >= _entryCount) {
+    i = _entryCount - 1;
+  }
+  RunIndexEntry entry;
+  if (fseek(_idx, sizeof(_header) + i * sizeof(entry), SEEK_SET) != 0
+      || fread(&entry, sizeof(entry), 1, _idx) != 1) {
+    return 0;
+  }
+  return entry.offset;
+}
+
+bool RunReader::parseLine(const char *line, Sample &sample) {
+  // minutes \t signal \t flags
+  if (line[0] == '#' || line[0] == '\0') {
+    return false;
+  }
+  char *end;
+  double minutes = strtod(line, &end);
+  if (end == line || *end != '\t') {
+    return false;
+  }
+  const char *p = end + 1;
+  sample.signal = strtof(p, &end);
+  if (end == p) {
+    return false;
+  }
+  sample.timeMs = (uint32_t)(minutes * 60000.0 + 0.5);
+
+  sample.flags.clear();
+  if (*end == '\t') {
+    for (p = end + 1; *p && *p != '\r' && *p != '\n'; p++) {
+      sample.flags += *p;
+    }
+  }
+  return true;
+}
+
+bool RunReader::readWindow(uint32_t fromMs, uint32_t toMs, std::vector<Sample> &samples) {
+  samples.clear();
+  if (!_csv) {
+    return false;
+  }
+  if (fseek(_csv, offsetFor(fromMs), SEEK_SET) != 0) {
+    return false;
+  }
+
+  char line[256];
+  Sample sample;
+  while (fgets(line, sizeof(line), _csv)) {
+    if (!parseLine(line, sample)) {
+      continue;
+    }
+    if (sample.timeMs >= toMs) {
+      break;
+    }
+    if (sample.timeMs >= fromMs) {
+      samples.push_back(sample);
+    }
+  }
+  return !ferror(_csv);
+}
@@ -0,0 +1,53 @@
+#ifndef RUNREADER_H
+#define RUNREADER_H
+
+// Host side reader for ArDAQ run files (RunNNNN.csv + RunNNNN.idx)
+// Not part of the sketch; build it into your own tools with a C++11 compiler.
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "../runindex.h"
+
+class RunReader {
+  public:
+    struct Sample {
+      uint32_t timeMs;
+      float signal;       // mAU
+      std::string flags;
+    };
+
+    RunReader();
+    ~RunReader();
+    RunReader(const RunReader &) = delete; // owns the open files
+    RunReader &operator=(const RunReader &) = delete;
+
+    // csvPath is the RunNNNN.csv file, the index is looked for next to it.
+    // Runs without an index (or with a damaged one) can still be read, but by scanning from the start.
+    bool open(const std::string &csvPath);
+    void close();
+
+    bool hasIndex() const   { return _hasIndex; }
+    bool hasSummary() const { return _hasSummary; }
+    const RunSummary &summary() const { return _summary; }
+
+    // Samples with from <= time < to (ms into the run). Messages ("#" lines) are skipped.
+    // Seeks straight to the index entry for 'from', so the cost doesn't depend on where in the run the window is.
+    bool readWindow(uint32_t fromMs, uint32_t toMs, std::vector<Sample> &samples);
+
+  private:
+    bool loadIndex(const std::string &idxPath);
+    uint32_t offsetFor(uint32_t timeMs);
+    static bool parseLine(const char *line, Sample &sample);
+
+    FILE *_csv;
+    FILE *_idx;
+    bool _hasIndex;
+    bool _hasSummary;
+    RunIndexHeader _header;
+    uint32_t _entryCount;
+    RunSummary _summary;
+};
+
+#endif
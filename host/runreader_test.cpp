@@ -0,0 +1,185 @@
+// Tests for RunReader, on run files written in the same format as the logger (see HSM::messagePrintln,
+// HSM::Sample::onInit and HSM::sdIndexSample).
+
+#include "runreader.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+static int failures = 0;
+#define CHECK(cond) do { if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+// Writes a run the way the logger does
+class RunWriter {
+  public:
+    RunWriter(const std::string &base, bool index) {
+      _csv = fopen((base + ".csv").c_str(), "wb");
+      _idx = index ? fopen((base + ".idx").c_str(), "wb") : 0;
+      _nextIndexTime = 0;
+      if (_idx) {
+        RunIndexHeader header;
+        memcpy(header.magic, "ADQI", 4);
+        header.version = RUN_INDEX_VERSION;
+        header.reserved = 0;
+        header.intervalMs = RUN_INDEX_INTERVAL;
+        fwrite(&header, sizeof(header), 1, _idx);
+      }
+    }
+    ~RunWriter() {
+      fclose(_csv);
+      if (_idx) {
+        fclose(_idx);
+      }
+    }
+    void message(const char *text) {
+      fprintf(_csv, "#\t2026/10/19 12:00:00\t%s\r\n", text);
+    }
+    void sample(uint32_t timeMs, float milliVolts, const char *flags) {
+      if (_idx && timeMs >= _nextIndexTime) {
+        RunIndexEntry entry;
+        entry.timeMs = timeMs;
+        entry.offset = ftell(_csv);
+        while (timeMs >= _nextIndexTime) {
+          fwrite(&entry, sizeof(entry), 1, _idx);
+          _nextIndexTime += RUN_INDEX_INTERVAL;
+        }
+      }
+      // dtostrf(timeMins, 0, 5, ..) and dtostrf(adcMilliVolts, 10, 4, ..)
+      fprintf(_csv, "%.5f\t%10.4f\t%s\r\n", timeMs / (1000.0 * 60), milliVolts, flags);
+    }
+    void summary(uint32_t sampleCount) {
+      RunSummary s;
+      memset(&s, 0, sizeof(s));
+      memcpy(s.magic, "ADQS", 4);
+      s.sampleCount = sampleCount;
+      s.minSignal = -1.5;
+      s.maxSignal = 250.0;
+      s.stopEvent = RUN_EVENT_SIGNAL;
+      fwrite(&s, sizeof(s), 1, _idx);
+    }
+
+  private:
+    FILE *_csv;
+    FILE *_idx;
+    uint32_t _nextIndexTime;
+};
+
+// 100ms conversions for 60s, with messages in between like a real run
+static uint32_t writeRun(RunWriter &w) {
+  uint32_t count = 0;
+  w.message("Logging to Run0001.csv");
+  w.message("Run started (commands: s=stop acq., c=calibrate adc, x=send shutdown)");
+  for (uint32_t t = 100; t < 60000; t += 100) {
+    if (t == 15000) {
+      w.message("HPSystem: Not Ready!");
+    }
+    if (t == 30000) {
+      // calibration gap, first sample after it is flagged
+      w.message("ADC offset calibrated, 7 conversions lost");
+      w.sample(t, 1.0, "NC");
+    } else if (t > 29200 && t < 30000) {
+      continue;
+    } else {
+      w.sample(t, t / 1000.0, "N");
+    }
+    count++;
+  }
+  w.message("Run ended");
+  return count;
+}
+
+static void testIndexedWindow() {
+  uint32_t count;
+  {
+    RunWriter w("/tmp/runreader_test_idx", true);
+    count = writeRun(w);
+    w.summary(count);
+  }
+
+  RunReader r;
+  CHECK(r.open("/tmp/runreader_test_idx.csv"));
+  CHECK(r.hasIndex());
+  CHECK(r.hasSummary());
+  CHECK(r.summary().sampleCount == count);
+  CHECK(r.summary().stopEvent == RUN_EVENT_SIGNAL);
+
+  std::vector<RunReader::Sample> samples;
+  CHECK(r.readWindow(14800, 15300, samples));
+  CHECK(samples.size() == 5);
+  if (samples.size() == 5) {
+    CHECK(samples[0].timeMs == 14800);
+    CHECK(samples[2].timeMs == 15000);
+    CHECK(samples[4].timeMs == 15200);
+    CHECK(samples[2].flags == "N");
+  }
+
+  // Window around the calibration gap keeps the flagged sample
+  CHECK(r.readWindow(29000, 30200, samples));
+  CHECK(samples.size() == 5); // 29000..29200, 30000, 30100
+  if (samples.size() == 5) {
+    CHECK(samples[3].timeMs == 30000);
+    CHECK(samples[3].flags == "NC");
+  }
+
+  // First sample of the run follows the run start messages
+  CHECK(r.readWindow(0, 500, samples));
+  CHECK(samples.size() == 4);
+  if (!samples.empty()) {
+    CHECK(samples[0].timeMs == 100);
+  }
+
+  // Past the end
+  CHECK(r.readWindow(120000, 130000, samples));
+  CHECK(samples.empty());
+}
+
+static void testWithoutIndex() {
+  remove("/tmp/runreader_test_noidx.idx");
+  {
+    RunWriter w("/tmp/runreader_test_noidx", false);
+    writeRun(w);
+  }
+
+  RunReader r;
+  CHECK(r.open("/tmp/runreader_test_noidx.csv"));
+  CHECK(!r.hasIndex());
+  CHECK(!r.hasSummary());
+
+  std::vector<RunReader::Sample> samples;
+  CHECK(r.readWindow(0, 400, samples));
+  CHECK(samples.size() == 3);
+  CHECK(r.readWindow(14800, 15300, samples));
+  CHECK(samples.size() == 5);
+}
+
+static void testUnfinishedRun() {
+  // Power lost mid-run: no summary, last entry only partly written
+  {
+    RunWriter w("/tmp/runreader_test_cut", true);
+    writeRun(w);
+  }
+  FILE *idx = fopen("/tmp/runreader_test_cut.idx", "ab");
+  fwrite("\x01\x02\x03", 3, 1, idx);
+  fclose(idx);
+
+  RunReader r;
+  CHECK(r.open("/tmp/runreader_test_cut.csv"));
+  CHECK(r.hasIndex());
+  CHECK(!r.hasSummary());
+
+  std::vector<RunReader::Sample> samples;
+  CHECK(r.readWindow(50000, 50500, samples));
+  CHECK(samples.size() == 5);
+}
+
+int main() {
+  testIndexedWindow();
+  testWithoutIndex();
+  testUnfinishedRun();
+  if (failures) {
+    printf("%d failure(s)\n", failures);
+    return 1;
+  }
+  printf("All tests passed\n");
+  return 0;
+}
@@ -5,6 +5,9 @@
 #include <RTClib.h>
 #include "hpsystem.h"
 #include "ads1232.h"
+#include "scratch.h"
+#include "runindex.h"
+#include "stackmon.h"
 
 // State instances (needed to make the linker happy)
 HSM::State              HSM::State::instance;
@@ -14,11 +17,15 @@ HSM::Idle               HSM::Idle::instance;
 HSM::Run                HSM::Run::instance;
 HSM::Sample             HSM::Sample::instance;
 HSM::WaitForConversion  HSM::WaitForConversion::instance;
+HSM::Sequence           HSM::Sequence::instance;
+HSM::SequenceWait       HSM::SequenceWait::instance;
+
+HSM::State             *HSM::Run::parent = 0;
 
 RTC_DS1307 *rtcg;
 
 // HIERARCHICHAL STATE MACHINE METHODS
-HSM::HSM(HPSystem &_hp, ADS1232 &_adc, RTC_DS1307 &_rtc, uint8_t _ledPin, uint8_t _sdCsPin) {
+HSM::HSM(HPSystem &_hp, ADS1232 &_adc, RTC_DS1307 &_rtc, uint8_t _ledPin, uint8_t _sdCsPin) : cal(0) {
   hp = &_hp;
   adc = &_adc;
   rtc = &_rtc;
@@ -75,25 +82,30 @@ void HSM::debugPrintln(const char *str) {
 
 void HSM::printDateTime() {
   DateTime now = rtc->now();
-  char timeBuf[24];
-  snprintf_P(timeBuf, 128, PSTR("#\t%04d/%02d/%02d %02d:%02d:%02d\t"), now.year(), now.month(), now.day(), now.hour(), now.minute(), now.second());
-  Serial.print(timeBuf);
+  snprintf_P(scratch.dateTime, sizeof(scratch.dateTime), PSTR("#\t%04d/%02d/%02d %02d:%02d:%02d\t"), now.year(), now.month(), now.day(), now.hour(), now.minute(), now.second());
+  Serial.print(scratch.dateTime);
   if (sdLogActive) {
-    sdPrint(timeBuf);
+    sdPrint(scratch.dateTime);
   }
 }
 void HSM::messagePrintln(const __FlashStringHelper* fstr) {
   printDateTime();
   Serial.println(fstr);
   if (sdLogActive) {
-    sdPrint(fstr);
+    // Terminate the line like Serial.println does, or the next sample ends up on the message line
+    if (sdPrint(fstr)) {
+      sdPrint(F("\r\n"));
+    }
   }
 }
 void HSM::messagePrintln(const char *str) {
   printDateTime();
   Serial.println(str);
   if (sdLogActive) {
-    sdPrint(str);
+    // Terminate the line like Serial.println does, or the next sample ends up on the message line
+    if (sdPrint(str)) {
+      sdPrint(F("\r\n"));
+    }
   }
 }
 
@@ -102,45 +114,212 @@ void sdDateTimeCallback(uint16_t* date, uint16_t* time) {
   *date = FAT_DATE(now.year(), now.month(), now.day());
   *time = FAT_TIME(now.hour(), now.minute(), now.second());
 }
+bool HSM::sdMount() {
+  // Don't leave the sequence manifest open on the volume that is about to be reinitialised
+  if (manifestFile.isOpen()) {
+    manifestFile.close();
+  }
+  sdManifestActive = false;
+
+  sdMounted = sd.begin(sdCsPin, SD_SCK_MHZ(4));
+  if (!sdMounted) {
+    messagePrintln(F("No SD card detected."));
+  }
+  lastRunNumber = 0;
+
+  if (sdMounted && inSequence() && manifestNumber != 0) {
+    sdManifestReopen();
+  }
+  return sdMounted;
+}
 bool HSM::sdLogInit() {
   sdLogActive = false;
 
-  if (!sd.begin(sdCsPin, SD_SCK_MHZ(4))) {
-    messagePrintln(F("No SD card detected."));
+  // Within a sequence the card stays mounted between runs
+  if (!(inSequence() && sdMounted) && !sdMount()) {
     return false;
   }
 
   if (file.isOpen()) {
     file.close();
   }
-  // Find an unused file name.
-  uint8_t runNumber = 0;
-  char filename[16];
+  // Find an unused file name. Within a sequence carry on from the last one.
+  uint8_t runNumber = lastRunNumber;
   do {
     runNumber++;
-    snprintf_P(filename, 16, PSTR("Run%04d.csv"), runNumber);
-  } while (sd.exists(filename) && runNumber < 255);
+    snprintf_P(scratch.filename, sizeof(scratch.filename), PSTR("Run%04d.csv"), runNumber);
+  } while (sd.exists(scratch.filename) && runNumber < 255);
   if (runNumber == 255) {
+    sdMounted = false; // e.g. card swapped between runs of a sequence, remount next time
     messagePrintln(F("Run out of file numbers, cannot log to SD card"));
     return false;
   }
 
   // Open the file
-  if ( ! file.open(filename, O_CREAT | O_WRITE | O_EXCL) ) {
+  if ( ! file.open(scratch.filename, O_CREAT | O_WRITE | O_EXCL) ) {
+    sdMounted = false;
     messagePrintln(F("Couldn't open file on SD card"));
     return false;
   }
   sdLogActive=true;
+  lastRunNumber = runNumber;
 
   file.dateTimeCallback(&sdDateTimeCallback);
 
-  char msg[64];
-  snprintf(msg, 64, "Logging to %s", filename);
-  messagePrintln(msg);
+  snprintf_P(scratch.message, sizeof(scratch.message), PSTR("Logging to %s"), scratch.filename);
+  messagePrintln(scratch.message);
+
+  sdIndexInit(runNumber);
+  return true;
+}
+bool HSM::sdIndexInit(uint8_t runNumber) {
+  sdIndexActive = false;
+  nextIndexTime = 0;
+
+  if (indexFile.isOpen()) {
+    indexFile.close();
+  }
+  snprintf_P(scratch.filename, sizeof(scratch.filename), PSTR("Run%04d.idx"), runNumber);
+  if ( ! indexFile.open(scratch.filename, O_CREAT | O_WRITE | O_TRUNC) ) {
+    messagePrintln(F("Couldn't open index file on SD card"));
+    return false;
+  }
+
+  RunIndexHeader header;
+  memcpy(header.magic, "ADQI", 4);
+  header.version = RUN_INDEX_VERSION;
+  header.reserved = 0;
+  header.intervalMs = RUN_INDEX_INTERVAL;
+  indexFile.write((const uint8_t *)&header, sizeof(header));
+  if (!indexFile.sync() || indexFile.getWriteError()) {
+    indexFile.close();
+    messagePrintln(F("! SD Index Write Error"));
+    return false;
+  }
+  sdIndexActive = true;
+  return true;
+}
+void HSM::sdIndexSample(uint32_t sampleTime) {
+  if (!sdIndexActive || sampleTime < nextIndexTime) {
+    return;
+  }
+  // One entry per interval, so the reader can find the entry for any time without searching.
+  // If a gap (e.g. calibration) spans several intervals, they all point at this sample.
+  RunIndexEntry entry;
+  entry.timeMs = sampleTime;
+  entry.offset = file.curPosition();
+  while (sampleTime >= nextIndexTime) {
+    indexFile.write((const uint8_t *)&entry, sizeof(entry));
+    nextIndexTime += RUN_INDEX_INTERVAL;
+  }
+  if (!indexFile.sync() || indexFile.getWriteError()) {
+    sdIndexActive = false;
+    indexFile.close();
+    summary.sdErrorCount++;
+    messagePrintln(F("! SD Index Write Error"));
+  }
+}
+void HSM::sdIndexSummary() {
+  if (!sdIndexActive) {
+    return;
+  }
+  memcpy(summary.magic, "ADQS", 4);
+  indexFile.write((const uint8_t *)&summary, sizeof(summary));
+  if (!indexFile.sync() || indexFile.getWriteError()) {
+    messagePrintln(F("! SD Index Write Error"));
+  }
+}
+void HSM::printMemoryUsage() {
+  uint16_t neverUsed = stackNeverUsed();
+  snprintf_P(scratch.message, sizeof(scratch.message), PSTR("RAM: %u bytes free, %u never used by stack"), stackFree(), neverUsed);
+  messagePrintln(scratch.message);
+  if (neverUsed < STACK_LOW_WARN) {
+    messagePrintln(F("! Stack is close to colliding with heap/static data"));
+  }
+}
+
+bool HSM::sdManifestInit() {
+  sdManifestActive = false;
+  if (!sdMounted) {
+    return false;
+  }
+
+  if (manifestFile.isOpen()) {
+    manifestFile.close();
+  }
+  uint8_t seqNumber = 0;
+  do {
+    seqNumber++;
+    snprintf_P(scratch.filename, sizeof(scratch.filename), PSTR("Seq%04d.csv"), seqNumber);
+  } while (sd.exists(scratch.filename) && seqNumber < 255);
+  if (seqNumber == 255) {
+    messagePrintln(F("Run out of file numbers, no sequence manifest"));
+    return false;
+  }
+  if ( ! manifestFile.open(scratch.filename, O_CREAT | O_WRITE | O_EXCL) ) {
+    messagePrintln(F("Couldn't open sequence manifest on SD card"));
+    return false;
+  }
+  sdManifestActive = true;
+  manifestNumber = seqNumber;
+
+  snprintf_P(scratch.message, sizeof(scratch.message), PSTR("Sequence manifest %s"), scratch.filename);
+  messagePrintln(scratch.message);
+  return sdManifestPrint(F("#\tfile\tstatus\tstart\tduration_ms\tsamples\tstop\r\n"));
+}
+bool HSM::sdManifestReopen() {
+  // Carry on with the same manifest after a remount (created again if the card was swapped)
+  snprintf_P(scratch.filename, sizeof(scratch.filename), PSTR("Seq%04d.csv"), manifestNumber);
+  if ( ! manifestFile.open(scratch.filename, O_CREAT | O_WRITE | O_APPEND) ) {
+    messagePrintln(F("Couldn't reopen sequence manifest on SD card"));
+    return false;
+  }
+  sdManifestActive = true;
+  return true;
+}
+bool HSM::sdManifestPrint(const __FlashStringHelper* fstr) {
+  if (sdManifestActive) {
+    manifestFile.print(fstr);
+    if (!manifestFile.sync() || manifestFile.getWriteError()) {
+      sdManifestClose();
+      messagePrintln(F("! SD Manifest Write Error"));
+      return false;
+    }
+  }
+  return true;
+}
+bool HSM::sdManifestPrint(const char* str) {
+  if (sdManifestActive) {
+    manifestFile.print(str);
+    if (!manifestFile.sync() || manifestFile.getWriteError()) {
+      sdManifestClose();
+      messagePrintln(F("! SD Manifest Write Error"));
+      return false;
+    }
+  }
+  return true;
+}
+void HSM::sdManifestClose() {
+  sdManifestActive = false;
+  manifestFile.close();
+}
+
+void HSM::printRunSummary() {
+  dtostrf(summary.minSignal, 0, 4, scratch.summary.minSignal);
+  dtostrf(summary.maxSignal, 0, 4, scratch.summary.maxSignal);
+  snprintf_P(scratch.message, sizeof(scratch.message), PSTR("Samples: %lu, signal %s to %s mAU"), (unsigned long)summary.sampleCount, scratch.summary.minSignal, scratch.summary.maxSignal);
+  messagePrintln(scratch.message);
+  snprintf_P(scratch.message, sizeof(scratch.message), PSTR("Errors: %u not ready, %u power, %u SD"), summary.notReadyCount, summary.powerFailCount, summary.sdErrorCount);
+  messagePrintln(scratch.message);
+  snprintf_P(scratch.message, sizeof(scratch.message), PSTR("Calibrations: %u, %u conversions lost"), summary.calibrationCount, summary.lostConversions);
+  messagePrintln(scratch.message);
 }
+
 void HSM::sdLogClose() {
   sdLogActive = false;
   file.close();
+  sdIndexActive = false;
+  indexFile.close();
 }
 
 bool HSM::sdPrint(const __FlashStringHelper* fstr) {
@@ -148,6 +327,8 @@ bool HSM::sdPrint(const __FlashStringHelper* fstr) {
     file.print(fstr);
     if (!file.sync() || file.getWriteError()) {
       sdLogClose();
+      sdMounted = false;
+      summary.sdErrorCount++;
       messagePrintln(F("! SD Write Error"));
       return false;
     }
@@ -159,6 +340,8 @@ bool HSM::sdPrint(const char* str) {
     file.print(str);
     if (!file.sync() || file.getWriteError()) {
       sdLogClose();
+      sdMounted = false;
+      summary.sdErrorCount++;
       messagePrintln(F("! SD Write Error"));
       return false;
     }
@@ -169,12 +352,13 @@ bool HSM::sdPrint(const char* str) {
 // Init
 void HSM::Init::onInitDone(HSM &hsm) {
   hsm.messagePrintln(F("ArDAQ Started"));
+  hsm.printMemoryUsage();
   hsm.transitionTo(HSM::Idle::instance);
 }
 
 // Idle
 void HSM::Idle::onEnter(HSM &hsm, HSM::State &fromState) {
-  hsm.messagePrintln(F("Idle (commands: s=start acq., r=send start req., x=send shutdown)"));
+  hsm.messagePrintln(F("Idle (commands: s=start acq., q=start sequence, r=send start req., m=memory usage, x=send shutdown)"));
   hsm.debugPrintln(F("Entering Idle"));
 }
 void HSM::Idle::onExit(HSM &hsm, HSM::State &toState) {
@@ -182,17 +366,25 @@ void HSM::Idle::onExit(HSM &hsm, HSM::State &toState) {
 }
 void HSM::Idle::onSignalStart(HSM &hsm) {
   hsm.messagePrintln(F("HPSystem: start signal received"));
+  hsm.runEvent = RUN_EVENT_SIGNAL;
   hsm.transitionTo(HSM::Run::instance);
 }
 void HSM::Idle::onSerialAvailable(HSM &hsm) {
   char incomingByte = Serial.read();
   switch (tolower(incomingByte)) {
     case 's':
+      hsm.runEvent = RUN_EVENT_MANUAL;
       hsm.transitionTo(HSM::Run::instance);
       break;
     case 'r':
       hsm.transitionTo(HSM::SendStartRequest::instance);
       break;
+    case 'q':
+      hsm.transitionTo(HSM::Sequence::instance);
+      break;
+    case 'm':
+      hsm.printMemoryUsage();
+      break;
     case 'x':
       hsm.hp->shutdown();
       break;
@@ -221,18 +413,51 @@ void HSM::SendStartRequest::onInit(HSM &hsm, HSM::State &fromState) {
 // Run
 void HSM::Run::onEnter(HSM &hsm, HSM::State &fromState) {
   hsm.debugPrintln(F("Entering Run"));
-  hsm.sdLogInit();
+  memset(&hsm.summary, 0, sizeof(hsm.summary));
+  hsm.summary.startTime = hsm.rtc->now().unixtime();
+  hsm.summary.startEvent = hsm.runEvent;
+  hsm.runEvent = RUN_EVENT_OTHER; // unless stopped by a signal or command
+  hsm.runFileOpened = hsm.sdLogInit();
   hsm.adc->enable();
-  hsm.adc->offset_calibration();
   hsm.sampleNumber = 0;
-  hsm.messagePrintln(F("Run started (commands: s=stop acq., x=send shutdown)"));
+  hsm.messagePrintln(F("Run started (commands: s=stop acq., c=calibrate adc, x=send shutdown)"));
   hsm.startTime = millis();
+  if (!hsm.inSequence()) {
+    // Calibrate after the first conversion rather than waiting for it here.
+    // In a sequence the adc is kept running and is calibrated between runs instead.
+    hsm.cal.reset(hsm.startTime);
+    hsm.cal.request();
+  } else {
+    hsm.cal.runStarted(hsm.startTime);
+  }
   digitalWrite(hsm.ledPin, HIGH);
 }
 void HSM::Run::onExit(HSM &hsm, HSM::State &toState) {
   hsm.debugPrintln(F("Exiting Run"));
   hsm.messagePrintln(F("Run ended"));
-  hsm.adc->disable();
+  hsm.summary.stopTimeMs = millis() - hsm.startTime;
+  hsm.summary.stopEvent = hsm.runEvent;
+  hsm.summary.sampleCount = hsm.sampleNumber;
+  hsm.printRunSummary();
+  hsm.sdIndexSummary();
+  hsm.printMemoryUsage();
+  if (hsm.inSequence()) {
+    // Every run gets a line, even if it couldn't be logged, so the sequence numbering has no holes
+    hsm.sequenceRuns++;
+    const char *status = (hsm.summary.sdErrorCount == 0 && hsm.runFileOpened) ? "ok" : "error";
+    if (hsm.runFileOpened) {
+      snprintf_P(scratch.manifest, sizeof(scratch.manifest), PSTR("%u\tRun%04d.csv\t%s\t%lu\t%lu\t%lu\t%u\r\n"),
+                 hsm.sequenceRuns, hsm.lastRunNumber, status, (unsigned long)hsm.summary.startTime,
+                 (unsigned long)hsm.summary.stopTimeMs, (unsigned long)hsm.summary.sampleCount, hsm.summary.stopEvent);
+    } else {
+      snprintf_P(scratch.manifest, sizeof(scratch.manifest), PSTR("%u\t-\t%s\t%lu\t%lu\t%lu\t%u\r\n"),
+                 hsm.sequenceRuns, status, (unsigned long)hsm.summary.startTime,
+                 (unsigned long)hsm.summary.stopTimeMs, (unsigned long)hsm.summary.sampleCount, hsm.summary.stopEvent);
+    }
+    hsm.sdManifestPrint(scratch.manifest);
+  } else {
+    hsm.adc->disable();
+  }
   digitalWrite(hsm.ledPin, LOW);
   hsm.sdLogClose();
 }
@@ -241,13 +466,19 @@ void HSM::Run::onInit(HSM &hsm, HSM::State &fromState) {
 }
 void HSM::Run::onSignalStop(HSM &hsm) {
   hsm.messagePrintln(F("HPSystem: stop signal received"));
-  hsm.transitionTo(HSM::Idle::instance); //// TODO postrun
+  hsm.runEvent = RUN_EVENT_SIGNAL;
+  hsm.transitionTo(hsm.runDoneState()); //// TODO postrun
 }
 void HSM::Run::onSerialAvailable(HSM &hsm) {
   char incomingByte = Serial.read();
   switch (tolower(incomingByte)) {
     case 's':
-      hsm.transitionTo(HSM::Idle::instance);
+      hsm.runEvent = RUN_EVENT_MANUAL;
+      hsm.transitionTo(hsm.runDoneState());
+      break;
+    case 'c':
+      hsm.messagePrintln(F("ADC offset calibration requested"));
+      hsm.cal.request();
       break;
     case 'x':
       hsm.hp->shutdown();
@@ -256,18 +487,143 @@ void HSM::Run::onSerialAvailable(HSM &hsm) {
   }
 }
 void HSM::Run::onSignalNotReady(HSM &hsm) {
+  hsm.summary.notReadyCount++;
   hsm.messagePrintln(F("HPSystem: Not Ready!"));
 }
 void HSM::Run::onSignalReady(HSM &hsm) {
   hsm.messagePrintln(F("HPSystem: Ready."));
 }
 void HSM::Run::onSignalPowerOff(HSM &hsm) {
+  hsm.summary.powerFailCount++;
   hsm.messagePrintln(F("HPSystem: Check module power!"));
 }
 void HSM::Run::onSignalPowerOn(HSM &hsm) {
   hsm.messagePrintln(F("HPSystem: Module power OK."));
 }
 
+// Sequence
+// Back to back runs for autosampler sequences. The SD card stays mounted and the adc stays powered up
+// between runs, so each START goes straight into a new run file. Run is entered as a child of Sequence.
+HSM::State &HSM::runDoneState() {
+  if (inSequence()) {
+    return HSM::SequenceWait::instance;
+  }
+  return HSM::Idle::instance;
+}
+void HSM::sequenceAutoStartRequest() {
+  // At most one per gap between runs; READY may drop and return again (e.g. post run equilibration)
+  // before the start arrives, and a second request could queue another injection.
+  if (sequenceAutoStart && !autoStartSent && hp->read_line(HPSystem::READY)) {
+    messagePrintln(F("Sending start request..."));
+    hp->startreq();
+    autoStartSent = true;
+  }
+}
+void HSM::Sequence::onEnter(HSM &hsm, HSM::State &fromState) {
+  hsm.debugPrintln(F("Entering Sequence"));
+  HSM::Run::parent = this;
+  hsm.sequenceRuns = 0;
+  hsm.manifestNumber = 0;
+  hsm.sdMount();
+  hsm.sdManifestInit();
+  hsm.adc->enable();
+  hsm.cal.reset(millis());
+}
+void HSM::Sequence::onExit(HSM &hsm, HSM::State &toState) {
+  hsm.debugPrintln(F("Exiting Sequence"));
+  snprintf_P(scratch.message, sizeof(scratch.message), PSTR("Sequence ended after %u runs"), hsm.sequenceRuns);
+  hsm.messagePrintln(scratch.message);
+  hsm.sdManifestClose();
+  hsm.adc->disable();
+  HSM::Run::parent = 0;
+}
+void HSM::Sequence::onInit(HSM &hsm, HSM::State &fromState) {
+  hsm.transitionTo(HSM::SequenceWait::instance);
+}
+
+// Sequence > SequenceWait
+void HSM::SequenceWait::onEnter(HSM &hsm, HSM::State &fromState) {
+  hsm.debugPrintln(F("Entering Sequence > SequenceWait"));
+  if (hsm.sequenceAutoStart) {
+    hsm.messagePrintln(F("Sequence: waiting for start, start req. sent when ready (commands: e=end sequence, s=start acq., r=send start req., a=toggle auto start req., x=send shutdown)"));
+  } else {
+    hsm.messagePrintln(F("Sequence: waiting for start (commands: e=end sequence, s=start acq., r=send start req., a=toggle auto start req., x=send shutdown)"));
+  }
+  // Make use of the dead time between runs
+  hsm.cal.request();
+  // READY may already be back (or never have gone away), in which case no ready signal will come
+  hsm.autoStartSent = false;
+  hsm.sequenceAutoStartRequest();
+}
+void HSM::SequenceWait::onExit(HSM &hsm, HSM::State &toState) {
+  hsm.debugPrintln(F("Exiting Sequence > SequenceWait"));
+}
+void HSM::SequenceWait::onSignalStart(HSM &hsm) {
+  hsm.messagePrintln(F("HPSystem: start signal received"));
+  hsm.runEvent = RUN_EVENT_SIGNAL;
+  hsm.transitionTo(HSM::Run::instance);
+}
+void HSM::SequenceWait::onSignalReady(HSM &hsm) {
+  hsm.messagePrintln(F("HPSystem: Ready."));
+  hsm.sequenceAutoStartRequest();
+}
+void HSM::SequenceWait::onSignalPrepare(HSM &hsm) {
+  // Between runs the adc is still running but nothing is being logged, so recalibrate
+  // before the next injection (e.g. if the gap has been longer than the calibration interval)
+  hsm.debugPrintln(F("HPSystem: prepare signal received, scheduling adc calibration"));
+  hsm.cal.request();
+}
+void HSM::SequenceWait::onSignalNotReady(HSM &hsm) {
+  hsm.messagePrintln(F("HPSystem: Not Ready!"));
+}
+void HSM::SequenceWait::onSignalPowerOff(HSM &hsm) {
+  hsm.messagePrintln(F("HPSystem: Check module power!"));
+}
+void HSM::SequenceWait::onSignalPowerOn(HSM &hsm) {
+  hsm.messagePrintln(F("HPSystem: Module power OK."));
+}
+void HSM::SequenceWait::onAdcDataReady(HSM &hsm) {
+  // Keep reading conversions so the calibration scheduler can run and knows the conversion period
+  hsm.adc->read_blocking();
+  uint32_t now = millis();
+  uint16_t lostConversions;
+  hsm.cal.sample(now, &lostConversions);
+  if (hsm.cal.due(now)) {
+    hsm.adc->start_offset_calibration();
+    hsm.cal.started(now);
+  }
+}
+void HSM::SequenceWait::onSerialAvailable(HSM &hsm) {
+  char incomingByte = Serial.read();
+  switch (tolower(incomingByte)) {
+    case 'e':
+      hsm.transitionTo(HSM::Idle::instance);
+      break;
+    case 's':
+      hsm.runEvent = RUN_EVENT_MANUAL;
+      hsm.transitionTo(HSM::Run::instance);
+      break;
+    case 'r':
+      hsm.messagePrintln(F("Sending start request..."));
+      hsm.hp->startreq();
+      hsm.autoStartSent = true; // don't follow it up with an automatic one
+      break;
+    case 'a':
+      hsm.sequenceAutoStart = !hsm.sequenceAutoStart;
+      if (hsm.sequenceAutoStart) {
+        hsm.messagePrintln(F("Sequence: start req. will be sent when ready"));
+        hsm.sequenceAutoStartRequest();
+      } else {
+        hsm.messagePrintln(F("Sequence: auto start req. off"));
+      }
+      break;
+    case 'x':
+      hsm.hp->shutdown();
+      hsm.transitionTo(HSM::Idle::instance);
+      break;
+  }
+}
+
 // Run > WaitForConversion
 void HSM::WaitForConversion::onEnter(HSM &hsm, HSM::State &fromState) {
   hsm.debugPrintln(F("Entering Run > WaitForConversion"));
@@ -289,37 +645,66 @@ void HSM::Sample::onExit(HSM &hsm, HSM::State &toState) {
 void HSM::Sample::onInit(HSM &hsm, HSM::State &fromState) {
   // Take the sample
   int32_t adcval = hsm.adc->read_blocking();
-  uint32_t sampleTime = millis() - hsm.startTime;
+  uint32_t now = millis();
+  uint32_t sampleTime = now - hsm.startTime;
+
+  // Offset calibration. Starting one doesn't block; the adc just won't be ready until it has finished.
+  uint16_t lostConversions = 0;
+  bool calibrated = hsm.cal.sample(now, &lostConversions);
+  if (hsm.cal.due(now)) {
+    hsm.adc->start_offset_calibration();
+    hsm.cal.started(now);
+    if (hsm.sampleNumber == 0) {
+      // Don't log the uncalibrated first conversion of the run
+      hsm.transitionTo(HSM::WaitForConversion::instance);
+      return;
+    }
+  }
   hsm.sampleNumber++;
+  if (calibrated) {
+    hsm.summary.calibrationCount++;
+    hsm.summary.lostConversions += lostConversions;
+  }
+  if (calibrated && lostConversions > 0) {
+    snprintf_P(scratch.message, sizeof(scratch.message), PSTR("ADC offset calibrated, %u conversions lost"), lostConversions);
+    hsm.messagePrintln(scratch.message);
+  }
 
   // Format the log line:
 
   // time in decimal mins
   float timeMins = sampleTime/(1000.0*60);
-  char timeBuf[24];
-  dtostrf(timeMins, 0, 5, timeBuf);
+  dtostrf(timeMins, 0, 5, scratch.sample.time);
 
   // flags
-  char flagBuf[8];
-  hsm.hp->getFlagString(flagBuf);
+  hsm.hp->getFlagString(scratch.sample.flags);
+  if (calibrated) {
+    // first sample after an offset calibration (preceded by a gap)
+    strcat(scratch.sample.flags, "C");
+  }
 
   // adc millivolts
   // ref = 2.470v = +-1.235v
   float adcMilliVolts = adcval * 1235.0/8388608;
   adcMilliVolts = (adcMilliVolts - 50.0) * 2; // convert to actual mAU
-  char milliVoltsBuf[16];
-  dtostrf(adcMilliVolts, 10, 4, milliVoltsBuf);
+  dtostrf(adcMilliVolts, 10, 4, scratch.sample.milliVolts);
+  if (hsm.sampleNumber == 1 || adcMilliVolts < hsm.summary.minSignal) {
+    hsm.summary.minSignal = adcMilliVolts;
+  }
+  if (hsm.sampleNumber == 1 || adcMilliVolts > hsm.summary.maxSignal) {
+    hsm.summary.maxSignal = adcMilliVolts;
+  }
 
   // stick it all together
-  char logBuf[128];
-  //snprintf(logBuf, 128, "%" PRId32 "\t%s\t%s\t%" PRId32 "\t%s\r\n", hsm.sampleNumber,  &timeBuf, &milliVoltsBuf, adcval, &flagBuf);
-  snprintf(logBuf, 128,  "%s\t%s\t%s\r\n",  &timeBuf, &milliVoltsBuf, &flagBuf);
+  //snprintf(scratch.sample.line, sizeof(scratch.sample.line), "%" PRId32 "\t%s\t%s\t%" PRId32 "\t%s\r\n", hsm.sampleNumber, scratch.sample.time, scratch.sample.milliVolts, adcval, scratch.sample.flags);
+  snprintf_P(scratch.sample.line, sizeof(scratch.sample.line), PSTR("%s\t%s\t%s\r\n"), scratch.sample.time, scratch.sample.milliVolts, scratch.sample.flags);
 
 
   // Then print/save it
-  Serial.print(logBuf);
+  Serial.print(scratch.sample.line);
   if (hsm.sdLogActive) {
-    bool written = hsm.sdPrint(logBuf);
+    hsm.sdIndexSample(sampleTime);
+    bool written = hsm.sdPrint(scratch.sample.line);
     if (!written) {
       // TODO: should probs shut down the system if logging fails half way through a run
     }
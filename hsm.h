@@ -7,6 +7,8 @@ class ADS1232;
 class RTC_DS1307;
 #include <SPI.h>
 #include "SdFat.h"
+#include "calscheduler.h"
+#include "runindex.h"
 
 class HSM {
   public:
@@ -70,10 +72,12 @@ class HSM {
       virtual void onSignalPowerOn(HSM &hsm);
   };
 
-  // Run
+  // Run (or Sequence > Run)
   class Run : public State {
     public:
       static Run instance;
+      static State *parent; // Sequence while one is active
+      virtual State *getParentInstance() { return parent; }
       virtual void onEnter(HSM &hsm, State &fromState);
       virtual void onExit(HSM &hsm, State &toState);
       virtual void onInit(HSM &hsm, State &fromState);
@@ -106,6 +110,33 @@ class HSM {
       virtual void onInit(HSM &hsm, State &fromState);
   };
 
+  // Sequence
+  class Sequence : public State {
+    public:
+      static Sequence instance;
+      virtual void onEnter(HSM &hsm, State &fromState);
+      virtual void onExit(HSM &hsm, State &toState);
+      virtual void onInit(HSM &hsm, State &fromState);
+  };
+
+  // Sequence > SequenceWait
+  class SequenceWait : public Sequence {
+    public:
+      static SequenceWait instance;
+      virtual State *getParentInstance() { return &Sequence::instance; }
+      virtual void onEnter(HSM &hsm, State &fromState);
+      virtual void onExit(HSM &hsm, State &toState);
+      virtual void onInit(HSM &hsm, State &fromState) {}
+      virtual void onSignalStart(HSM &hsm);
+      virtual void onSerialAvailable(HSM &hsm);
+      virtual void onSignalPrepare(HSM &hsm);
+      virtual void onSignalNotReady(HSM &hsm);
+      virtual void onSignalReady(HSM &hsm);
+      virtual void onSignalPowerOff(HSM &hsm);
+      virtual void onSignalPowerOn(HSM &hsm);
+      virtual void onAdcDataReady(HSM &hsm);
+  };
+
   // Shutdown
   class Shutdown : public State {
     public:
@@ -115,6 +146,9 @@ class HSM {
   // Constructor & transitionTo method
   HSM(HPSystem &_hp, ADS1232 &_adc, RTC_DS1307 &_rtc, uint8_t _ledPin, uint8_t _sdCsPin);
   void transitionTo(State &newState);
+  void setCalibrationInterval(uint32_t ms) { cal.setInterval(ms); }
+  void setConversionPeriod(uint32_t ms)    { cal.setNominalPeriod(ms); }
+  void setSequenceAutoStart(bool enable)   { sequenceAutoStart = enable; }
 
   // Delegate events to the current state
   void onSignalStart()        { currentState->onSignalStart(*this);        }
@@ -143,19 +177,49 @@ private:
 
   uint32_t startTime;
   uint32_t sampleNumber;
+  CalScheduler cal; // ADC offset calibration
+  RunSummary summary;
+  uint8_t runEvent = RUN_EVENT_OTHER; // what started/stopped the run, see RunEvent
+
+  bool inSequence() { return Run::parent == &Sequence::instance; }
+  State &runDoneState(); // where Run goes when it is stopped
+  uint16_t sequenceRuns;
+  bool sequenceAutoStart = false; // send a start request whenever READY returns between runs
+  void sequenceAutoStartRequest(); // send one now if auto start is on and the system is ready
+  bool autoStartSent = false;      // a start request has gone out since the last run
+  bool runFileOpened = false;
 
   void printDateTime();
+  void printMemoryUsage();
+  void printRunSummary();
   void debugPrintln(const char *str);
   void debugPrintln(const __FlashStringHelper* fstr);
   void messagePrintln(const char *str);
   void messagePrintln(const __FlashStringHelper* fstr);
+  bool sdMount();
   bool sdLogInit();
   void sdLogClose();
+  bool sdIndexInit(uint8_t runNumber);
+  void sdIndexSample(uint32_t sampleTime);
+  void sdIndexSummary();
   bool sdPrint(const char* str);
   bool sdPrint(const __FlashStringHelper* fstr);
   SdFat sd; // File system object.
+  bool sdMounted = false;
+  uint8_t lastRunNumber = 0;
   bool sdLogActive = false;
   SdFile file; // Log file.
+  SdFile indexFile; // Time index for the log file, see runindex.h
+  bool sdIndexActive = false;
+  uint32_t nextIndexTime;
+  bool sdManifestInit();
+  bool sdManifestReopen();
+  bool sdManifestPrint(const char* str);
+  bool sdManifestPrint(const __FlashStringHelper* fstr);
+  void sdManifestClose();
+  SdFile manifestFile; // Sequence manifest, one line per run.
+  bool sdManifestActive = false;
+  uint8_t manifestNumber = 0; // SeqNNNN.csv of the current sequence, 0 if none
 };
 
 #endif
@@ -0,0 +1,56 @@
+#ifndef RUNINDEX_H
+#define RUNINDEX_H
+
+// Run index sidecar file format (RunNNNN.idx next to RunNNNN.csv)
+// Shared between the logger and the host side reader (host/runreader.h), so only fixed size types.
+//
+//   RunIndexHeader
+//   RunIndexEntry * n    entry i = first sample at or after i * intervalMs into the run
+//   RunSummary           only present if the run was ended cleanly
+//
+// All fields are little endian, and the structs are laid out so that there is no padding on either side.
+
+#include <stdint.h>
+
+#define RUN_INDEX_VERSION  1
+#define RUN_INDEX_INTERVAL 10000UL // ms between index entries
+
+struct RunIndexHeader {
+  char magic[4];        // "ADQI"
+  uint16_t version;
+  uint16_t reserved;
+  uint32_t intervalMs;
+};
+
+struct RunIndexEntry {
+  uint32_t timeMs;      // run time of the sample
+  uint32_t offset;      // byte offset of its line in the csv file
+};
+
+enum RunEvent {
+  RUN_EVENT_MANUAL = 0, // serial command
+  RUN_EVENT_SIGNAL = 1, // HPSystem start/stop line
+  RUN_EVENT_OTHER  = 2, // shutdown, power loss, ...
+};
+
+struct RunSummary {
+  char magic[4];        // "ADQS"
+  uint32_t sampleCount;
+  float minSignal;      // mAU
+  float maxSignal;      // mAU
+  uint32_t startTime;   // RTC unix time of the start of the run
+  uint32_t stopTimeMs;  // run time at which the run was stopped
+  uint8_t startEvent;   // RunEvent
+  uint8_t stopEvent;    // RunEvent
+  uint16_t notReadyCount;
+  uint16_t powerFailCount;
+  uint16_t sdErrorCount;
+  uint16_t calibrationCount;
+  uint16_t lostConversions;
+};
+
+static_assert(sizeof(RunIndexHeader) == 12, "RunIndexHeader layout");
+static_assert(sizeof(RunIndexEntry) == 8, "RunIndexEntry layout");
+static_assert(sizeof(RunSummary) == 36, "RunSummary layout");
+
+#endif
@@ -0,0 +1,3 @@
+#include "scratch.h"
+
+Scratch scratch;
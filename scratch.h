@@ -0,0 +1,49 @@
+#ifndef SCRATCH_H
+#define SCRATCH_H
+
+// Statically allocated buffers for formatting and logging, instead of putting them on the (tiny) stack.
+// dateTime and message are used from anywhere (messagePrintln -> printDateTime), so they get their own space.
+// The rest share one union: each member has a single owner, and the owners are never active at the same time.
+
+#include <stdint.h>
+
+struct SampleScratch {
+  char time[12];       // run time in minutes, dtostrf(.., 0, 5, ..)
+  char milliVolts[12]; // signal, dtostrf(.., 10, 4, ..)
+  char flags[10];      // HPSystem flags + calibration flag
+  char line[12 + 12 + 10 + 4]; // time \t milliVolts \t flags \r\n
+};
+
+struct SummaryScratch {
+  char minSignal[12];  // dtostrf(.., 0, 4, ..)
+  char maxSignal[12];
+};
+
+struct Scratch {
+  char dateTime[24];   // HSM::printDateTime
+  char message[64];    // text passed to HSM::messagePrintln
+  union {
+    char filename[16];      // opening files: sdLogInit, sdIndexInit, sdManifestInit
+    SampleScratch sample;   // Run > Sample
+    SummaryScratch summary; // HSM::printRunSummary
+    char manifest[64];      // Run::onExit: sequence manifest line
+  };
+};
+
+static_assert(sizeof(Scratch::dateTime) >= sizeof("#\t2099/12/31 23:59:59\t"), "dateTime buffer too small");
+static_assert(sizeof(Scratch::filename) >= sizeof("Run0255.csv"), "filename buffer too small");
+static_assert(sizeof(Scratch::message) >= sizeof("Logging to ") + sizeof(Scratch::filename), "message buffer too small");
+static_assert(sizeof(SampleScratch::time) >= sizeof("71582.78827"), "time buffer too small for a full millis() range in minutes");
+static_assert(sizeof(SampleScratch::milliVolts) >= sizeof("-2570.0000"), "milliVolts buffer too small for full scale");
+static_assert(sizeof(SummaryScratch::minSignal) >= sizeof("-2570.0000"), "summary buffer too small for full scale");
+static_assert(sizeof(SummaryScratch::maxSignal) >= sizeof("-2570.0000"), "summary buffer too small for full scale");
+static_assert(sizeof(SampleScratch::flags) >= 8 + 1, "flags buffer must hold HPSystem::getFlagString() plus one flag");
+static_assert(sizeof(SampleScratch::line) >= sizeof(SampleScratch::time) + sizeof(SampleScratch::milliVolts) + sizeof(SampleScratch::flags) + 4,
+              "log line buffer too small for its fields");
+static_assert(sizeof(Scratch::manifest) >= sizeof("65535\tRun0255.csv\terror\t4294967295\t4294967295\t4294967295\t255\r\n"),
+              "manifest buffer too small");
+static_assert(sizeof(Scratch) <= 256, "scratch arena is eating too much of the 2K of SRAM");
+
+extern Scratch scratch;
+
+#endif
@@ -0,0 +1,33 @@
+#include "stackmon.h"
+#include <Arduino.h>
+
+extern uint8_t _end;      // end of .data/.bss, start of the heap
+extern uint8_t __stack;   // top of RAM
+extern char *__brkval;    // end of the heap, 0 if malloc has never been used
+
+// Runs before main() (and before .data is copied / .bss is cleared, which don't touch this area anyway).
+// Must not use the stack itself, hence naked.
+void stackPaint() __attribute__((naked, used, section(".init3")));
+void stackPaint() {
+  uint8_t *p = &_end;
+  while (p <= &__stack) {
+    *p = STACK_CANARY;
+    p++;
+  }
+}
+
+uint16_t stackNeverUsed() {
+  // Start above the heap, anything malloc has handed out has overwritten the canary
+  const uint8_t *p = (__brkval == 0 ? &_end : (uint8_t *)__brkval);
+  uint16_t count = 0;
+  while (p <= &__stack && *p == STACK_CANARY) {
+    p++;
+    count++;
+  }
+  return count;
+}
+
+uint16_t stackFree() {
+  char top;
+  return &top - (__brkval == 0 ? (char *)&_end : __brkval);
+}
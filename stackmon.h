@@ -0,0 +1,17 @@
+#ifndef STACKMON_H
+#define STACKMON_H
+
+#include <stdint.h>
+
+// Stack high water mark monitoring.
+// At reset, all RAM between the end of the static data and the top of the stack is painted with a canary
+// value. stackNeverUsed() counts how much of it is still untouched, i.e. how close the stack has ever come
+// to the heap/static data since power up.
+
+#define STACK_CANARY   0xC5
+#define STACK_LOW_WARN 128 // bytes
+
+uint16_t stackNeverUsed();
+uint16_t stackFree(); // currently free, between the heap and the stack pointer
+
+#endif